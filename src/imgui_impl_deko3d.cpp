@@ -1,8 +1,11 @@
 #include "imgui_impl_deko3d.h"
 
 #include <deko3d.hpp>
+#include <algorithm>
+#include <math.h>
 #include <stdio.h>
 #include <switch.h>
+#include <vector>
 
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/mat4x4.hpp>
@@ -10,10 +13,21 @@
 #define FB_NUM 2
 #define FB_WIDTH 1280
 #define FB_HEIGHT 720
-#define CODEMEMSIZE (4 * 1024)
+#define CODEMEMSIZE (8 * 1024)
 #define CMDMEMSIZE (1024 * 1024)
 #define MAX_TEX_NUM 4
 
+#define FONT_SIZE 18.0f
+// distance-field font: baked once at SDF_FONT_SIZE and scaled at draw time
+#define SDF_FONT_SIZE 32.0f
+#define SDF_SPREAD 4
+
+#ifdef IMGUI_IMPL_DEKO3D_SDF_FONT
+#define SDF_FONT 1
+#else
+#define SDF_FONT 0
+#endif
+
 struct VertUBO {
   glm::mat4 proj;
 };
@@ -37,6 +51,7 @@ struct ImGui_ImplDeko3d_Data {
   dk::UniqueMemBlock codeMemBlock;
   dk::Shader vertexShader;
   dk::Shader fragmentShader;
+  dk::Shader sdfFragmentShader;
 
   dk::UniqueMemBlock uboMemBlock;
   dk::UniqueMemBlock vtxMemBlock[FB_NUM];
@@ -46,6 +61,7 @@ struct ImGui_ImplDeko3d_Data {
   dk::UniqueMemBlock textureMemBlock[MAX_TEX_NUM];
   DkResHandle textureHandle[MAX_TEX_NUM];
   int tex_cnt = 0;
+  int font_tex_id = -1;
 
   dk::UniqueMemBlock cmdbufMemBlock[FB_NUM];
   dk::UniqueCmdBuf cmdbuf[FB_NUM];
@@ -94,6 +110,9 @@ static void InitDeko3Shaders(ImGui_ImplDeko3d_Data *bd) {
   codeMemOffset +=
       loadShader(bd->fragmentShader, "romfs:/shaders/imgui_fsh.dksh",
                  bd->codeMemBlock, codeMemOffset);
+  codeMemOffset +=
+      loadShader(bd->sdfFragmentShader, "romfs:/shaders/imgui_sdf_fsh.dksh",
+                 bd->codeMemBlock, codeMemOffset);
   IM_ASSERT(codeMemOffset + DK_SHADER_CODE_UNUSABLE_SIZE <= CODEMEMSIZE);
 }
 
@@ -159,9 +178,10 @@ static void InitDeko3dSwapchain(ImGui_ImplDeko3d_Data *bd) {
   }
 }
 
-static void ImGui_LoadSwitchFonts(ImGuiIO &io) {
+static ImFont *AddSwitchFonts(ImFontAtlas *atlas, float size,
+                              ImFontConfig font_cfg) {
   PlFontData standard, extended, chinese, korean;
-  ImWchar extended_range[] = {0xe000, 0xe152};
+  static const ImWchar extended_range[] = {0xe000, 0xe152, 0};
   bool ok = R_SUCCEEDED(
                 plGetSharedFontByType(&standard, PlSharedFontType_Standard)) &&
             R_SUCCEEDED(plGetSharedFontByType(&extended,
@@ -171,24 +191,244 @@ static void ImGui_LoadSwitchFonts(ImGuiIO &io) {
             R_SUCCEEDED(plGetSharedFontByType(&korean, PlSharedFontType_KO));
   IM_ASSERT(ok);
 
-  ImFontConfig font_cfg;
   font_cfg.FontDataOwnedByAtlas = false;
-  io.Fonts->AddFontFromMemoryTTF(standard.address, standard.size, 18.0f,
-                                 &font_cfg, io.Fonts->GetGlyphRangesDefault());
+  ImFont *font = atlas->AddFontFromMemoryTTF(standard.address, standard.size,
+                                             size, &font_cfg,
+                                             atlas->GetGlyphRangesDefault());
   font_cfg.MergeMode = true;
-  io.Fonts->AddFontFromMemoryTTF(extended.address, extended.size, 18.0f,
-                                 &font_cfg, extended_range);
+  atlas->AddFontFromMemoryTTF(extended.address, extended.size, size, &font_cfg,
+                              extended_range);
   // NOTE: uncomment to enable Chinese/Korean support but with slow startup time
   /*
-  io.Fonts->AddFontFromMemoryTTF(
-      chinese.address, chinese.size, 18.0f, &font_cfg,
-      io.Fonts->GetGlyphRangesChineseSimplifiedCommon());
-  io.Fonts->AddFontFromMemoryTTF(korean.address, korean.size, 18.0f, &font_cfg,
-                                 io.Fonts->GetGlyphRangesKorean());
+  atlas->AddFontFromMemoryTTF(chinese.address, chinese.size, size, &font_cfg,
+                              atlas->GetGlyphRangesChineseSimplifiedCommon());
+  atlas->AddFontFromMemoryTTF(korean.address, korean.size, size, &font_cfg,
+                              atlas->GetGlyphRangesKorean());
   */
 
-  io.Fonts->Flags |= ImFontAtlasFlags_NoPowerOfTwoHeight;
-  io.Fonts->Build();
+  atlas->Flags |= ImFontAtlasFlags_NoPowerOfTwoHeight;
+  return font;
+}
+
+static ImFont *AddSwitchSdfFonts(ImFontAtlas *atlas) {
+  // the field is resampled at any scale, so oversampling only wastes space
+  ImFontConfig font_cfg;
+  font_cfg.OversampleH = font_cfg.OversampleV = 1;
+  ImFont *font = AddSwitchFonts(atlas, SDF_FONT_SIZE, font_cfg);
+  font->Scale = FONT_SIZE / SDF_FONT_SIZE;
+
+  // glyph quads are grown by the spread after the build, so keep a full
+  // spread between a grown quad and its neighbour's ink; drop the baked
+  // lines and cursors which only make sense as coverage bitmaps
+  atlas->TexGlyphPadding = 2 * SDF_SPREAD;
+  atlas->Flags |=
+      ImFontAtlasFlags_NoBakedLines | ImFontAtlasFlags_NoMouseCursors;
+  return font;
+}
+
+// 1D squared euclidean distance transform (Felzenszwalb & Huttenlocher)
+static void DistanceTransform1D(float *grid, int offset, int stride, int length,
+                                float *f, float *z, int *v) {
+  for (int q = 0; q < length; ++q)
+    f[q] = grid[offset + q * stride];
+  v[0] = 0;
+  z[0] = -1e20f;
+  z[1] = 1e20f;
+  for (int q = 1, k = 0; q < length; ++q) {
+    float s;
+    do {
+      int r = v[k];
+      s = (f[q] - f[r] + q * q - r * r) / (q - r) / 2;
+    } while (s <= z[k] && --k > -1);
+    ++k;
+    v[k] = q;
+    z[k] = s;
+    z[k + 1] = 1e20f;
+  }
+  for (int q = 0, k = 0; q < length; ++q) {
+    while (z[k + 1] < q)
+      ++k;
+    int r = v[k];
+    grid[offset + q * stride] = f[r] + (q - r) * (q - r);
+  }
+}
+
+static void DistanceTransform2D(float *grid, int width, int height, float *f,
+                                float *z, int *v) {
+  for (int x = 0; x < width; ++x)
+    DistanceTransform1D(grid, x, width, height, f, z, v);
+  for (int y = 0; y < height; ++y)
+    DistanceTransform1D(grid, y * width, 1, width, f, z, v);
+}
+
+// turn an alpha8 coverage atlas into a signed distance field in place, with
+// the glyph edge at 128 and SDF_SPREAD pixels on either side of it
+static void ConvertAtlasToSdf(unsigned char *pixels, int width, int height) {
+  int size = width * height, len = std::max(width, height);
+  std::vector<float> outer(size), inner(size), f(len), z(len + 1);
+  std::vector<int> v(len);
+
+  // anti-aliased pixels seed a sub-pixel distance to the edge
+  for (int i = 0; i < size; ++i) {
+    float a = pixels[i] / 255.0f;
+    if (a == 1.0f) {
+      outer[i] = 0.0f;
+      inner[i] = 1e20f;
+    } else if (a == 0.0f) {
+      outer[i] = 1e20f;
+      inner[i] = 0.0f;
+    } else {
+      float d = 0.5f - a;
+      outer[i] = d > 0.0f ? d * d : 0.0f;
+      inner[i] = d < 0.0f ? d * d : 0.0f;
+    }
+  }
+  DistanceTransform2D(outer.data(), width, height, f.data(), z.data(),
+                      v.data());
+  DistanceTransform2D(inner.data(), width, height, f.data(), z.data(),
+                      v.data());
+
+  for (int i = 0; i < size; ++i) {
+    float d = sqrtf(outer[i]) - sqrtf(inner[i]);
+    float val = 0.5f - d / (2.0f * SDF_SPREAD);
+    pixels[i] = (unsigned char)(std::clamp(val, 0.0f, 1.0f) * 255.0f + 0.5f);
+  }
+}
+
+// the packer puts the glyph padding on the left and top of each rect and
+// sizes the texture to the last rect, so the lowest glyph ends on the last
+// row; append SDF_SPREAD empty rows to leave room for its field below
+static void PadSdfAtlas(ImFontAtlas *atlas) {
+  unsigned char *pixels;
+  int width, height;
+  atlas->GetTexDataAsAlpha8(&pixels, &width, &height);
+  int new_height = height + SDF_SPREAD;
+  auto new_pixels = (unsigned char *)IM_ALLOC(width * new_height);
+  memcpy(new_pixels, pixels, width * height);
+  memset(new_pixels + width * height, 0, width * SDF_SPREAD);
+  IM_FREE(pixels);
+  atlas->TexPixelsAlpha8 = new_pixels;
+  atlas->TexHeight = new_height;
+  atlas->TexUvScale.y = 1.0f / new_height;
+
+  // rescale every v coordinate baked against the old height
+  float v_scale = (float)height / new_height;
+  atlas->TexUvWhitePixel.y *= v_scale;
+  for (ImFont *font : atlas->Fonts) {
+    for (ImFontGlyph &glyph : font->Glyphs) {
+      glyph.V0 *= v_scale;
+      glyph.V1 *= v_scale;
+    }
+  }
+}
+
+// grow every glyph quad by the spread so the outer side of the field, where
+// the edge is anti-aliased, is not clipped at the ink bounding box
+static void ExpandSdfGlyphs(ImFontAtlas *atlas) {
+  float du = SDF_SPREAD * atlas->TexUvScale.x;
+  float dv = SDF_SPREAD * atlas->TexUvScale.y;
+  for (ImFont *font : atlas->Fonts) {
+    for (ImFontGlyph &glyph : font->Glyphs) {
+      if (!glyph.Visible)
+        continue;
+      // the padding and PadSdfAtlas leave a full spread around every glyph
+      float x0 = glyph.U0 * atlas->TexWidth, x1 = glyph.U1 * atlas->TexWidth;
+      float y0 = glyph.V0 * atlas->TexHeight, y1 = glyph.V1 * atlas->TexHeight;
+      IM_ASSERT(x0 + 0.5f >= SDF_SPREAD &&
+                x1 + SDF_SPREAD <= atlas->TexWidth + 0.5f);
+      IM_ASSERT(y0 + 0.5f >= SDF_SPREAD &&
+                y1 + SDF_SPREAD <= atlas->TexHeight + 0.5f);
+
+      // glyph units per uv, 1 texel per unit without oversampling
+      float sx = (glyph.X1 - glyph.X0) / (glyph.U1 - glyph.U0);
+      float sy = (glyph.Y1 - glyph.Y0) / (glyph.V1 - glyph.V0);
+      glyph.U0 -= du;
+      glyph.U1 += du;
+      glyph.V0 -= dv;
+      glyph.V1 += dv;
+      glyph.X0 -= du * sx;
+      glyph.X1 += du * sx;
+      glyph.Y0 -= dv * sy;
+      glyph.Y1 += dv * sy;
+    }
+  }
+}
+
+// build the atlas and replace its alpha8 texture data with the field
+static void BuildSdfAtlas(ImFontAtlas *atlas) {
+  unsigned char *pixels;
+  int width, height;
+  atlas->Build();
+  PadSdfAtlas(atlas);
+  ExpandSdfGlyphs(atlas);
+  atlas->GetTexDataAsAlpha8(&pixels, &width, &height);
+  ConvertAtlasToSdf(pixels, width, height);
+
+  // non-text geometry samples the white pixel through the sdf shader too, so
+  // keep that rect fully inside rather than at whatever its field came to
+  const ImFontAtlasCustomRect *r =
+      atlas->GetCustomRectByIndex(atlas->PackIdMouseCursors);
+  for (int y = r->Y; y < r->Y + r->Height; ++y)
+    memset(pixels + y * width + r->X, 0xFF, r->Width);
+}
+
+#ifdef IMGUI_IMPL_DEKO3D_FONT_BENCHMARK
+static void LogFontAtlas(const char *name, ImFontAtlas *atlas, int channel,
+                         u64 start) {
+  u64 ns = armTicksToNs(armGetSystemTick() - start);
+  int width = atlas->TexWidth, height = atlas->TexHeight;
+  printf("font %s: %dx%d atlas, %d texels, %d KiB, %.2f ms\n", name, width,
+         height, width * height, width * height * channel / 1024, ns / 1e6);
+}
+
+static void BenchmarkSwitchFonts() {
+  const float sizes[] = {14.0f, 18.0f, 24.0f, 32.0f};
+  unsigned char *pixels;
+  int width, height;
+
+  // one bitmap font per size with the default config, uploaded as RGBA32
+  u64 start = armGetSystemTick();
+  ImFontAtlas bitmap;
+  for (float size : sizes)
+    AddSwitchFonts(&bitmap, size, ImFontConfig());
+  bitmap.Build();
+  bitmap.GetTexDataAsRGBA32(&pixels, &width, &height);
+  LogFontAtlas("bitmap rgba32", &bitmap, 4, start);
+
+  // the same sizes with the sdf config and pixel format, so only the
+  // per-size rasterization differs from the distance-field atlas below
+  start = armGetSystemTick();
+  ImFontAtlas alpha8;
+  ImFontConfig font_cfg;
+  font_cfg.OversampleH = font_cfg.OversampleV = 1;
+  for (float size : sizes)
+    AddSwitchFonts(&alpha8, size, font_cfg);
+  alpha8.Flags |=
+      ImFontAtlasFlags_NoBakedLines | ImFontAtlasFlags_NoMouseCursors;
+  alpha8.Build();
+  alpha8.GetTexDataAsAlpha8(&pixels, &width, &height);
+  LogFontAtlas("bitmap alpha8", &alpha8, 1, start);
+
+  // a single distance-field font serving every size, uploaded as R8
+  start = armGetSystemTick();
+  ImFontAtlas sdf;
+  AddSwitchSdfFonts(&sdf);
+  BuildSdfAtlas(&sdf);
+  LogFontAtlas("sdf", &sdf, 1, start);
+}
+#endif
+
+static void ImGui_LoadSwitchFonts(ImGuiIO &io) {
+#ifdef IMGUI_IMPL_DEKO3D_FONT_BENCHMARK
+  BenchmarkSwitchFonts();
+#endif
+  if (SDF_FONT) {
+    AddSwitchSdfFonts(io.Fonts);
+    BuildSdfAtlas(io.Fonts);
+  } else {
+    AddSwitchFonts(io.Fonts, FONT_SIZE, ImFontConfig());
+    io.Fonts->Build();
+  }
 }
 
 static void InitDeko3dDescriptors(ImGui_ImplDeko3d_Data *bd) {
@@ -223,13 +463,19 @@ static void InitDeko3dFontTexture(ImGui_ImplDeko3d_Data *bd) {
   ImGui_LoadSwitchFonts(io);
 
   auto tex_id = bd->tex_cnt++;
+  bd->font_tex_id = tex_id;
   bd->textureHandle[tex_id] = dkMakeTextureHandle(tex_id, tex_id);
   io.Fonts->SetTexID(ImGui_ImplDeko3d_GetTextureId(tex_id));
 
   // copy font data to scratch buffer
   unsigned char *pixels;
   int width, height, channel;
-  io.Fonts->GetTexDataAsRGBA32(&pixels, &width, &height, &channel);
+  if (SDF_FONT) {
+    // already converted to a distance field by BuildSdfAtlas
+    io.Fonts->GetTexDataAsAlpha8(&pixels, &width, &height, &channel);
+  } else {
+    io.Fonts->GetTexDataAsRGBA32(&pixels, &width, &height, &channel);
+  }
   dk::UniqueMemBlock scratchMemBlock =
       dk::MemBlockMaker(device,
                         align(width * height * channel, DK_MEMBLOCK_ALIGNMENT))
@@ -241,7 +487,8 @@ static void InitDeko3dFontTexture(ImGui_ImplDeko3d_Data *bd) {
   dk::ImageLayout layout;
   dk::ImageLayoutMaker{device}
       .setFlags(0)
-      .setFormat(DkImageFormat_RGBA8_Unorm)
+      .setFormat(channel == 1 ? DkImageFormat_R8_Unorm
+                              : DkImageFormat_RGBA8_Unorm)
       .setDimensions(width, height)
       .initialize(layout);
   bd->textureMemBlock[tex_id] =
@@ -523,6 +770,7 @@ void ImGui_ImplDeko3d_RenderDrawData(ImDrawData *drawData) {
   cmdbuf.bindIdxBuffer(DkIdxFormat_Uint16, bd->idxMemBlock[slot].getGpuAddr());
 
   DkResHandle boundTextureHandle = ~0;
+  bool boundSdfShader = false;
   size_t vtxOffset = 0, idxOffset = 0;
   for (int i = 0; i < drawData->CmdListsCount; ++i) {
     const ImDrawList &cmdList = *drawData->CmdLists[i];
@@ -544,6 +792,15 @@ void ImGui_ImplDeko3d_RenderDrawData(ImDrawData *drawData) {
       if (handle != boundTextureHandle) {
         boundTextureHandle = handle;
         cmdbuf.bindTextures(DkStage_Fragment, 0, handle);
+        // distance-field glyphs need their own fragment shader; it also
+        // draws the solid fills and shapes sharing the font texture, which
+        // stay opaque because BuildSdfAtlas saturates the white pixel
+        bool sdf = SDF_FONT && handle == bd->textureHandle[bd->font_tex_id];
+        if (sdf != boundSdfShader) {
+          boundSdfShader = sdf;
+          cmdbuf.bindShaders(DkStageFlag_Fragment, {sdf ? &bd->sdfFragmentShader
+                                                        : &bd->fragmentShader});
+        }
       }
       // draw the triangle list
       cmdbuf.drawIndexed(DkPrimitive_Triangles, cmd.ElemCount, 1,
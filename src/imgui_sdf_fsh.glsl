@@ -0,0 +1,16 @@
+#version 460
+
+layout (location = 0) in vec2 vtxUv;
+layout (location = 1) in vec4 vtxColor;
+
+layout (binding = 0) uniform sampler2D tex;
+
+layout (location = 0) out vec4 outColor;
+
+void main() {
+    // distance field in [0, 1] with the glyph edge at 0.5
+    float dist = texture(tex, vtxUv).r;
+    float width = max(0.7 * length(vec2(dFdx(dist), dFdy(dist))), 1e-4);
+    float alpha = smoothstep(0.5 - width, 0.5 + width, dist);
+    outColor = vec4(vtxColor.rgb, vtxColor.a * alpha);
+}